@@ -1,5 +1,6 @@
 ﻿#include "pch.h"
 #include "win_printer_management.h"
+#include "win_print_scheduler.h"
 #include "convert_string_to_utf8.h"
 #include <combaseapi.h>
 #include <stdint.h>
@@ -69,6 +70,47 @@ extern "C" {
         return ConvertWStringToUtf8(json);
     }
 
+    __declspec(dllexport) char* PrintDirectOptimizedJson(const wchar_t* printerName, const uint8_t* data, const size_t dataLen, const wchar_t* docName, const wchar_t* dataType) {
+        std::wstring json = WinPrinterManagement::printDirectOptimizedJson(printerName, data, dataLen, docName, dataType);
+        return ConvertWStringToUtf8(json);
+    }
+
+    // 'printerNames' es una lista de nombres separados por '\0' y terminada en doble '\0'
+    // (mismo formato que REG_MULTI_SZ), p. ej. L"Cocina\0Barra\0Caja\0\0".
+    // Los datos se comparten entre todas las impresoras, no se copian.
+    __declspec(dllexport) char* PrintDirectMultiJson(const wchar_t* printerNames, const uint8_t* data, const size_t dataLen, const wchar_t* docName, const wchar_t* dataType) {
+        std::vector<std::wstring> names;
+        for (const wchar_t* name = printerNames; name && *name; name += wcslen(name) + 1) {
+            names.emplace_back(name);
+        }
+        std::wstring json = WinPrinterManagement::printDirectMultiJson(names, data, dataLen, docName, dataType);
+        return ConvertWStringToUtf8(json);
+    }
+
+    // Encola el trabajo y retorna de inmediato con un ticket (los datos se copian).
+    // 'lane' es "URGENT", "NORMAL" o "BULK" (nullptr = "NORMAL"); 'deadlineMs' es el plazo
+    // en milisegundos desde ahora, 0 = sin plazo. 'escPos' = los datos RAW son ESC/POS: solo
+    // entonces se dividen en bloques y se les añaden comandos; si no, se envían enteros.
+    __declspec(dllexport) char* SubmitPrintJobJson(const wchar_t* printerName, const uint8_t* data, const size_t dataLen, const wchar_t* docName, const wchar_t* dataType, const char* lane, DWORD deadlineMs, bool escPos) {
+        std::wstring json = WinPrinterManagement::submitPrintJobJson(printerName, data, dataLen, docName, dataType, escPos, lane ? lane : "", deadlineMs);
+        return ConvertWStringToUtf8(json);
+    }
+
+    __declspec(dllexport) char* GetQueuedJobJson(DWORD ticket) {
+        std::wstring json = WinPrinterManagement::getQueuedJobJson(ticket);
+        return ConvertWStringToUtf8(json);
+    }
+
+    __declspec(dllexport) char* GetQueueMetricsJson() {
+        std::wstring json = WinPrinterManagement::getQueueMetricsJson();
+        return ConvertWStringToUtf8(json);
+    }
+
+    __declspec(dllexport) char* GetSupportedPrintLanesJson() {
+        std::wstring json = WinPrinterManagement::getSupportedPrintLanesJson();
+        return ConvertWStringToUtf8(json);
+    }
+
     __declspec(dllexport) void FreeString(char* str) {
         if (str) {
             CoTaskMemFree(str);
@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "escpos_commands.h"
+
+// -------------------- Helpers --------------------
+
+// Longitud fija: devuelve 'len' si cabe en lo que queda del buffer, 0 en caso contrario.
+static size_t fixedLength(size_t len, size_t avail) {
+    return len <= avail ? len : 0;
+}
+
+// Longitud de un comando con cabecera de 'header' bytes seguida de un bloque de 'dataLen' bytes.
+static size_t blockLength(size_t header, size_t dataLen, size_t avail) {
+    return fixedLength(header + dataLen, avail);
+}
+
+// Longitud de un comando terminado en NUL que empieza a buscar en p[start].
+static size_t nulTerminatedLength(const uint8_t* p, size_t start, size_t avail) {
+    for (size_t i = start; i < avail; ++i) {
+        if (p[i] == 0x00)
+            return i + 1;
+    }
+    return 0;
+}
+
+// ESC x ...
+static size_t escLength(const uint8_t* p, size_t avail) {
+    if (avail < 2)
+        return 0;
+    switch (p[1]) {
+    case '2': case '<': case '@': case 'L': case 'S': case 'i': case 'm': case 'v':
+        return 2;
+    case ' ': case '!': case '%': case '-': case '3': case '=': case '?': case 'E': case 'G':
+    case 'J': case 'M': case 'R': case 'T': case 'U': case 'V': case 'a': case 'd': case 'e':
+    case 'r': case 't': case 'u': case '{':
+        return fixedLength(3, avail);
+    case '$': case '\\': case 'c':
+        return fixedLength(4, avail);
+    case 'p':
+        return fixedLength(5, avail);
+    case 'W':
+        return fixedLength(10, avail);
+    case 'D':
+        // ESC D n1 ... nk NUL
+        return nulTerminatedLength(p, 2, avail);
+    case '*': {
+        // ESC * m nL nH d1 ... dk
+        if (avail < 5)
+            return 0;
+        size_t columns = p[3] + p[4] * 256;
+        size_t bytesPerColumn = (p[2] == 32 || p[2] == 33) ? 3 : 1;
+        return blockLength(5, columns * bytesPerColumn, avail);
+    }
+    case '&': {
+        // ESC & y c1 c2 [x d1 ... d(y*x)] ...
+        if (avail < 5)
+            return 0;
+        size_t y = p[2];
+        size_t len = 5;
+        for (int c = p[3]; c <= p[4]; ++c) {
+            if (len >= avail)
+                return 0;
+            len += 1 + y * p[len];
+        }
+        return fixedLength(len, avail);
+    }
+    case '(': {
+        // ESC ( fn pL pH d1 ... dk
+        if (avail < 5)
+            return 0;
+        return blockLength(5, p[3] + p[4] * 256, avail);
+    }
+    default:
+        return 0;
+    }
+}
+
+// GS x ...
+static size_t gsLength(const uint8_t* p, size_t avail) {
+    if (avail < 2)
+        return 0;
+    switch (p[1]) {
+    case ':':
+        return 2;
+    case '!': case '/': case 'B': case 'E': case 'H': case 'I': case 'T': case 'a': case 'b':
+    case 'f': case 'h': case 'r': case 'w':
+        return fixedLength(3, avail);
+    case '$': case 'L': case 'P': case 'W': case '\\':
+        return fixedLength(4, avail);
+    case '^':
+        return fixedLength(5, avail);
+    case 'V': {
+        // GS V m / GS V m n
+        if (avail < 3)
+            return 0;
+        switch (p[2]) {
+        case 0: case 1: case 48: case 49:
+            return 3;
+        case 65: case 66: case 97: case 98: case 103: case 104:
+            return fixedLength(4, avail);
+        default:
+            return 0;
+        }
+    }
+    case '(': {
+        // GS ( fn pL pH d1 ... dk
+        if (avail < 5)
+            return 0;
+        return blockLength(5, p[3] + p[4] * 256, avail);
+    }
+    case '8': {
+        // GS 8 L p1 p2 p3 p4 d1 ... dk
+        if (avail < 7 || p[2] != 'L')
+            return 0;
+        size_t len = p[3] + (static_cast<size_t>(p[4]) << 8) + (static_cast<size_t>(p[5]) << 16) + (static_cast<size_t>(p[6]) << 24);
+        return blockLength(7, len, avail);
+    }
+    case '*': {
+        // GS * x y d1 ... d(x*y*8)
+        if (avail < 4)
+            return 0;
+        return blockLength(4, static_cast<size_t>(p[2]) * p[3] * 8, avail);
+    }
+    case 'v': {
+        // GS v 0 m xL xH yL yH d1 ... dk
+        if (avail < 8 || p[2] != '0')
+            return 0;
+        size_t width = p[4] + p[5] * 256;
+        size_t height = p[6] + p[7] * 256;
+        return blockLength(8, width * height, avail);
+    }
+    case 'k': {
+        // GS k m d1 ... dk NUL (m <= 6) / GS k m n d1 ... dn (m >= 65)
+        if (avail < 3)
+            return 0;
+        if (p[2] <= 6)
+            return nulTerminatedLength(p, 3, avail);
+        if (avail < 4)
+            return 0;
+        return blockLength(4, p[3], avail);
+    }
+    default:
+        return 0;
+    }
+}
+
+// FS x ...
+static size_t fsLength(const uint8_t* p, size_t avail) {
+    if (avail < 2)
+        return 0;
+    switch (p[1]) {
+    case '&': case '.':
+        return 2;
+    case '!': case '-': case 'C': case 'W':
+        return fixedLength(3, avail);
+    case 'S': case 'p':
+        return fixedLength(4, avail);
+    case '(': {
+        // FS ( fn pL pH d1 ... dk
+        if (avail < 5)
+            return 0;
+        return blockLength(5, p[3] + p[4] * 256, avail);
+    }
+    default:
+        return 0;
+    }
+}
+
+// DLE x ... (comandos en tiempo real)
+static size_t dleLength(const uint8_t* p, size_t avail) {
+    if (avail < 2)
+        return 0;
+    switch (p[1]) {
+    case 0x04: case 0x05:
+        // DLE EOT n / DLE ENQ n
+        return fixedLength(3, avail);
+    case 0x14: {
+        // DLE DC4 fn ...
+        if (avail < 3)
+            return 0;
+        switch (p[2]) {
+        case 1: case 2:
+            return fixedLength(5, avail);
+        case 7:
+            return fixedLength(4, avail);
+        case 8:
+            return fixedLength(10, avail);
+        default:
+            return 0;
+        }
+    }
+    default:
+        return 0;
+    }
+}
+
+// -------------------- Funciones pblicas --------------------
+
+size_t getEscPosCommandLength(const uint8_t* data, size_t dataLen, size_t pos) {
+    if (!data || pos >= dataLen)
+        return 0;
+    const uint8_t* p = data + pos;
+    size_t avail = dataLen - pos;
+    switch (p[0]) {
+    case ESCPOS_ESC:
+        return escLength(p, avail);
+    case ESCPOS_GS:
+        return gsLength(p, avail);
+    case ESCPOS_FS:
+        return fsLength(p, avail);
+    case ESCPOS_DLE:
+        return dleLength(p, avail);
+    default:
+        return 1;
+    }
+}
+
+bool isEscPosCut(const uint8_t* command, size_t commandLen) {
+    return commandLen >= 3 && command[0] == ESCPOS_GS && command[1] == 'V';
+}
@@ -0,0 +1,23 @@
+#ifndef ESCPOS_COMMANDS_H
+#define ESCPOS_COMMANDS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Prefijos de comandos ESC/POS.
+const uint8_t ESCPOS_LF = 0x0A;
+const uint8_t ESCPOS_DLE = 0x10;
+const uint8_t ESCPOS_ESC = 0x1B;
+const uint8_t ESCPOS_FS = 0x1C;
+const uint8_t ESCPOS_GS = 0x1D;
+
+// Devuelve la longitud total (en bytes) del comando ESC/POS que empieza en data[pos],
+// incluyendo el prefijo y todos sus parmetros/datos.
+// Cualquier byte que no sea un prefijo de comando (texto, LF, CR...) cuenta como 1.
+// Devuelve 0 si el comando no se reconoce o si est incompleto (se sale del buffer).
+size_t getEscPosCommandLength(const uint8_t* data, size_t dataLen, size_t pos);
+
+// Indica si el comando (ya delimitado con getEscPosCommandLength) es un corte de papel (GS V).
+bool isEscPosCut(const uint8_t* command, size_t commandLen);
+
+#endif // ESCPOS_COMMANDS_H
@@ -0,0 +1,377 @@
+#include "pch.h"
+#include "escpos_optimizer.h"
+#include "escpos_commands.h"
+
+// Longitud mnima de una racha de LF para sustituirla por ESC d n (3 bytes).
+const size_t MIN_LINE_FEED_RUN = 4;
+
+// Estado tras ESC @. La fuente, la tabla de cdigos y el juego de caracteres por defecto
+// dependen de la configuracin de cada impresora, as que quedan como desconocidos.
+const int escPosInitialState[ESCPOS_PROP_COUNT] = {
+    0, 0, 0, ESCPOS_UNKNOWN, 0, 0, 0, 0, ESCPOS_DEFAULT_LINE_SPACING, ESCPOS_UNKNOWN, ESCPOS_UNKNOWN
+};
+
+// Normaliza los parmetros 0/1/2 o '0'/'1'/'2'. Devuelve ESCPOS_UNKNOWN si n no es vlido.
+static int decodeDigit(uint8_t n, int max) {
+    int value = n >= '0' ? n - '0' : n;
+    return value >= 0 && value <= max ? value : ESCPOS_UNKNOWN;
+}
+
+// Identifica un comando de cambio de modo. Devuelve la propiedad que modifica, o
+// ESCPOS_PROP_COUNT si el comando no es de cambio de modo. 'value' queda en ESCPOS_UNKNOWN
+// si el parmetro no es vlido o si el efecto del comando no se puede predecir.
+static int decodeModeCommand(const uint8_t* cmd, size_t len, bool atLineStart, int& value) {
+    value = ESCPOS_UNKNOWN;
+    if (len == 2 && cmd[0] == ESCPOS_ESC && cmd[1] == '2') {
+        value = ESCPOS_DEFAULT_LINE_SPACING;
+        return ESCPOS_PROP_LINE_SPACING;
+    }
+    if (len != 3)
+        return ESCPOS_PROP_COUNT;
+    uint8_t n = cmd[2];
+    if (cmd[0] == ESCPOS_ESC) {
+        switch (cmd[1]) {
+        case 'E':
+            value = n & 1;
+            return ESCPOS_PROP_EMPHASIS;
+        case 'G':
+            value = n & 1;
+            return ESCPOS_PROP_DOUBLE_STRIKE;
+        case '-':
+            value = decodeDigit(n, 2);
+            return ESCPOS_PROP_UNDERLINE;
+        case 'M':
+            value = decodeDigit(n, 4);
+            return ESCPOS_PROP_FONT;
+        case 'a':
+            // Fuera del principio de lnea la impresora lo ignora: el estado queda desconocido.
+            value = atLineStart ? decodeDigit(n, 2) : ESCPOS_UNKNOWN;
+            return ESCPOS_PROP_JUSTIFICATION;
+        case '{':
+            value = atLineStart ? (n & 1) : ESCPOS_UNKNOWN;
+            return ESCPOS_PROP_UPSIDE_DOWN;
+        case '3':
+            value = n;
+            return ESCPOS_PROP_LINE_SPACING;
+        case 't':
+            value = n;
+            return ESCPOS_PROP_CODE_TABLE;
+        case 'R':
+            value = n;
+            return ESCPOS_PROP_CHARSET;
+        }
+    }
+    else if (cmd[0] == ESCPOS_GS) {
+        switch (cmd[1]) {
+        case '!':
+            value = (n & 0x0F) <= 7 && (n >> 4) <= 7 ? n : ESCPOS_UNKNOWN;
+            return ESCPOS_PROP_CHAR_SIZE;
+        case 'B':
+            value = n & 1;
+            return ESCPOS_PROP_REVERSE;
+        }
+    }
+    return ESCPOS_PROP_COUNT;
+}
+
+// Escribe el comando cannico que fija 'value' en la propiedad 'prop'.
+static void encodeModeCommand(int prop, int value, std::vector<uint8_t>& out) {
+    static const uint8_t commands[ESCPOS_PROP_COUNT][2] = {
+        {ESCPOS_ESC, 'E'}, {ESCPOS_ESC, 'G'}, {ESCPOS_ESC, '-'}, {ESCPOS_ESC, 'M'},
+        {ESCPOS_GS, '!'}, {ESCPOS_GS, 'B'}, {ESCPOS_ESC, 'a'}, {ESCPOS_ESC, '{'},
+        {ESCPOS_ESC, '3'}, {ESCPOS_ESC, 't'}, {ESCPOS_ESC, 'R'}
+    };
+    if (prop == ESCPOS_PROP_LINE_SPACING && value == ESCPOS_DEFAULT_LINE_SPACING) {
+        out.push_back(ESCPOS_ESC);
+        out.push_back('2');
+        return;
+    }
+    out.push_back(commands[prop][0]);
+    out.push_back(commands[prop][1]);
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Indica si el comando deja la impresora al principio de una lnea.
+static bool endsLine(const uint8_t* cmd, size_t len) {
+    if (len == 1)
+        return cmd[0] == ESCPOS_LF;
+    if (cmd[0] == ESCPOS_ESC)
+        return cmd[1] == '@' || cmd[1] == 'd' || cmd[1] == 'J';
+    return isEscPosCut(cmd, len);
+}
+
+// -------------------- Optimizador --------------------
+
+struct EscPosOptimizer {
+    std::vector<uint8_t>& out;
+    int printer[ESCPOS_PROP_COUNT];   // Estado ya enviado a la impresora.
+    int pending[ESCPOS_PROP_COUNT];   // Estado pedido por el flujo, an sin enviar.
+    size_t lineFeeds;                 // LF pendientes de emitir.
+    bool atLineStart;
+    bool emittedSinceInit;            // Se ha emitido algo desde el ltimo ESC @.
+
+    EscPosOptimizer(std::vector<uint8_t>& output) : out(output), lineFeeds(0), atLineStart(false), emittedSinceInit(true) {
+        for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop) {
+            printer[prop] = ESCPOS_UNKNOWN;
+            pending[prop] = ESCPOS_UNKNOWN;
+        }
+    }
+
+    void emitLineFeeds() {
+        if (lineFeeds == 0)
+            return;
+        if (lineFeeds < MIN_LINE_FEED_RUN) {
+            out.insert(out.end(), lineFeeds, ESCPOS_LF);
+        }
+        else {
+            while (lineFeeds > 0) {
+                size_t n = lineFeeds < 255 ? lineFeeds : 255;
+                out.push_back(ESCPOS_ESC);
+                out.push_back('d');
+                out.push_back(static_cast<uint8_t>(n));
+                lineFeeds -= n;
+            }
+        }
+        lineFeeds = 0;
+        emittedSinceInit = true;
+    }
+
+    // Emite los cambios de modo pendientes que difieren del estado de la impresora.
+    void flushModes() {
+        for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop) {
+            if (pending[prop] == printer[prop])
+                continue;
+            emitLineFeeds();
+            encodeModeCommand(prop, pending[prop], out);
+            printer[prop] = pending[prop];
+            emittedSinceInit = true;
+        }
+    }
+
+    void flush() {
+        flushModes();
+        emitLineFeeds();
+    }
+
+    // Copia un comando tal cual, despus de aplicar todo lo pendiente.
+    void passThrough(const uint8_t* cmd, size_t len) {
+        flush();
+        out.insert(out.end(), cmd, cmd + len);
+        emittedSinceInit = true;
+        // Los comandos en tiempo real (DLE) no imprimen ni mueven el papel.
+        if (cmd[0] != ESCPOS_DLE)
+            atLineStart = endsLine(cmd, len);
+    }
+
+    // Marca una propiedad como desconocida tras un comando cuyo efecto no se sigue.
+    void forget(int prop) {
+        printer[prop] = ESCPOS_UNKNOWN;
+        pending[prop] = ESCPOS_UNKNOWN;
+    }
+
+    void forgetAll() {
+        for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop)
+            forget(prop);
+    }
+
+    // Procesa un comando. Devuelve false si a partir de aqu no se puede seguir optimizando.
+    bool process(const uint8_t* cmd, size_t len) {
+        if (len == 1 && cmd[0] == ESCPOS_LF) {
+            flushModes();
+            lineFeeds++;
+            atLineStart = true;
+            return true;
+        }
+        if (len == 2 && cmd[0] == ESCPOS_ESC && cmd[1] == '@') {
+            // ESC @ anula cualquier cambio de modo pendiente.
+            emitLineFeeds();
+            if (emittedSinceInit) {
+                out.insert(out.end(), cmd, cmd + len);
+                emittedSinceInit = false;
+            }
+            for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop) {
+                printer[prop] = escPosInitialState[prop];
+                pending[prop] = escPosInitialState[prop];
+            }
+            atLineStart = true;
+            return true;
+        }
+        if (len == 2 && ((cmd[0] == ESCPOS_ESC && cmd[1] == 'L') || (cmd[0] == ESCPOS_GS && cmd[1] == ':'))) {
+            // Modo pgina: la posicin de impresin ya no sigue las reglas del modo estndar.
+            // Macro (GS :): los comandos se guardan para ejecutarlos luego, fuera de este orden.
+            passThrough(cmd, len);
+            return false;
+        }
+        if (len == 5 && cmd[0] == ESCPOS_GS && cmd[1] == '^') {
+            // Ejecucin de macro: reproduce comandos que no se han seguido.
+            passThrough(cmd, len);
+            return false;
+        }
+        if (len == 3 && cmd[0] == ESCPOS_ESC && cmd[1] == '=') {
+            // Con la impresora deshabilitada (otro perifrico seleccionado) los comandos se ignoran,
+            // as que tras cualquier ESC = el estado real es desconocido.
+            passThrough(cmd, len);
+            forgetAll();
+            return true;
+        }
+        int value = ESCPOS_UNKNOWN;
+        int prop = decodeModeCommand(cmd, len, atLineStart, value);
+        if (prop != ESCPOS_PROP_COUNT) {
+            if (value != ESCPOS_UNKNOWN) {
+                pending[prop] = value;
+            }
+            else {
+                flush();
+                out.insert(out.end(), cmd, cmd + len);
+                emittedSinceInit = true;
+                forget(prop);
+            }
+            return true;
+        }
+        passThrough(cmd, len);
+        if (len == 3 && cmd[0] == ESCPOS_ESC && cmd[1] == '!') {
+            // ESC ! cambia a la vez negrita, subrayado, fuente y tamao.
+            forget(ESCPOS_PROP_EMPHASIS);
+            forget(ESCPOS_PROP_UNDERLINE);
+            forget(ESCPOS_PROP_FONT);
+            forget(ESCPOS_PROP_CHAR_SIZE);
+        }
+        return true;
+    }
+};
+
+std::vector<uint8_t> optimizeEscPos(const uint8_t* data, size_t dataLen, EscPosOptimizeStats& stats) {
+    std::vector<uint8_t> out;
+    out.reserve(dataLen);
+    EscPosOptimizer optimizer(out);
+
+    size_t pos = 0;
+    while (pos < dataLen) {
+        size_t len = getEscPosCommandLength(data, dataLen, pos);
+        if (len == 0)
+            break;
+        bool keepGoing = optimizer.process(data + pos, len);
+        pos += len;
+        if (!keepGoing)
+            break;
+    }
+    optimizer.flush();
+    out.insert(out.end(), data + pos, data + dataLen);
+
+    stats.bytesIn = dataLen;
+    stats.bytesOut = out.size();
+    return out;
+}
+
+// -------------------- Seguimiento de estado --------------------
+
+// Indica si el comando imprime, avanza el papel o corta sin cambiar ningn ajuste de la impresora.
+static bool isStatelessCommand(const uint8_t* cmd, size_t len) {
+    if (len == 1)
+        return cmd[0] >= 0x20 || cmd[0] == ESCPOS_LF || cmd[0] == 0x0D || cmd[0] == 0x09;
+    if (cmd[0] == ESCPOS_ESC) {
+        switch (cmd[1]) {
+        case 'd': case 'J': case 'p': case 'i': case 'm': case '*':
+            return true;
+        }
+        return false;
+    }
+    if (cmd[0] == ESCPOS_GS)
+        return cmd[1] == 'k' || cmd[1] == 'v' || isEscPosCut(cmd, len);
+    return false;
+}
+
+EscPosStateTracker::EscPosStateTracker()
+    : printMode(ESCPOS_UNKNOWN), atLineStart(false), pageMode(false), macroDefinition(false), macroDefined(false),
+      printerEnabled(true), restorable(true) {
+    for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop)
+        state[prop] = ESCPOS_UNKNOWN;
+}
+
+void EscPosStateTracker::process(const uint8_t* cmd, size_t len) {
+    if (cmd[0] == ESCPOS_DLE)
+        return;
+    if (len == 3 && cmd[0] == ESCPOS_ESC && cmd[1] == '=') {
+        printerEnabled = (cmd[2] & 1) != 0;
+        return;
+    }
+    // Con otro perifrico seleccionado la impresora ignora todo lo dems.
+    if (!printerEnabled)
+        return;
+    if (len == 2 && cmd[0] == ESCPOS_GS && cmd[1] == ':') {
+        macroDefinition = !macroDefinition;
+        macroDefined = true;
+        restorable = false;
+        return;
+    }
+    if (len == 1 && cmd[0] == 0x0C) {
+        pageMode = false;
+        atLineStart = true;
+        return;
+    }
+    if (len == 2 && cmd[0] == ESCPOS_ESC) {
+        switch (cmd[1]) {
+        case '@':
+            for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop)
+                state[prop] = escPosInitialState[prop];
+            printMode = ESCPOS_UNKNOWN;
+            pageMode = false;
+            atLineStart = true;
+            restorable = !macroDefined;
+            return;
+        case 'L':
+            pageMode = true;
+            return;
+        case 'S':
+            pageMode = false;
+            return;
+        }
+    }
+    if (len == 5 && cmd[0] == ESCPOS_GS && cmd[1] == '^') {
+        // La macro puede cambiar cualquier modo.
+        for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop)
+            state[prop] = ESCPOS_UNKNOWN;
+        printMode = ESCPOS_UNKNOWN;
+        atLineStart = false;
+        restorable = false;
+        return;
+    }
+    if (len == 3 && cmd[0] == ESCPOS_ESC && cmd[1] == '!') {
+        printMode = cmd[2];
+        state[ESCPOS_PROP_EMPHASIS] = ESCPOS_UNKNOWN;
+        state[ESCPOS_PROP_UNDERLINE] = ESCPOS_UNKNOWN;
+        state[ESCPOS_PROP_FONT] = ESCPOS_UNKNOWN;
+        state[ESCPOS_PROP_CHAR_SIZE] = ESCPOS_UNKNOWN;
+        return;
+    }
+    int value = ESCPOS_UNKNOWN;
+    int prop = decodeModeCommand(cmd, len, atLineStart, value);
+    if (prop != ESCPOS_PROP_COUNT) {
+        state[prop] = value;
+        // Parmetro invlido, o ESC a / ESC { sin saber si se est al principio de lnea.
+        if (value == ESCPOS_UNKNOWN)
+            restorable = false;
+        return;
+    }
+    if (!isStatelessCommand(cmd, len))
+        restorable = false;
+    atLineStart = endsLine(cmd, len);
+}
+
+void EscPosStateTracker::appendRestoreCommands(std::vector<uint8_t>& out) const {
+    out.push_back(ESCPOS_ESC);
+    out.push_back('@');
+    if (printMode != ESCPOS_UNKNOWN) {
+        out.push_back(ESCPOS_ESC);
+        out.push_back('!');
+        out.push_back(static_cast<uint8_t>(printMode));
+    }
+    for (int prop = 0; prop < ESCPOS_PROP_COUNT; ++prop) {
+        if (state[prop] == ESCPOS_UNKNOWN)
+            continue;
+        // Tras ESC ! tambin hay que repetir los valores por defecto que se fijaron despus.
+        if (state[prop] == escPosInitialState[prop] && printMode == ESCPOS_UNKNOWN)
+            continue;
+        encodeModeCommand(prop, state[prop], out);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef ESCPOS_OPTIMIZER_H
+#define ESCPOS_OPTIMIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Propiedades de estado de la impresora que siguen el optimizador y EscPosStateTracker.
+enum EscPosProperty {
+    ESCPOS_PROP_EMPHASIS,       // ESC E n
+    ESCPOS_PROP_DOUBLE_STRIKE,  // ESC G n
+    ESCPOS_PROP_UNDERLINE,      // ESC - n
+    ESCPOS_PROP_FONT,           // ESC M n
+    ESCPOS_PROP_CHAR_SIZE,      // GS ! n
+    ESCPOS_PROP_REVERSE,        // GS B n
+    ESCPOS_PROP_JUSTIFICATION,  // ESC a n (solo al principio de lnea)
+    ESCPOS_PROP_UPSIDE_DOWN,    // ESC { n (solo al principio de lnea)
+    ESCPOS_PROP_LINE_SPACING,   // ESC 2 / ESC 3 n
+    ESCPOS_PROP_CODE_TABLE,     // ESC t n
+    ESCPOS_PROP_CHARSET,        // ESC R n
+    ESCPOS_PROP_COUNT
+};
+
+// Valor de una propiedad que no se conoce (p. ej. al principio del flujo).
+const int ESCPOS_UNKNOWN = -1;
+
+// Valor de ESCPOS_PROP_LINE_SPACING para el interlineado por defecto (ESC 2).
+const int ESCPOS_DEFAULT_LINE_SPACING = 256;
+
+// Resultado de una pasada del optimizador.
+struct EscPosOptimizeStats {
+    size_t bytesIn;
+    size_t bytesOut;
+};
+
+// Reescribe un flujo ESC/POS con menos bytes e igual resultado impreso.
+// - Los cambios de modo (negrita, subrayado, alineacin, tamao...) se aplazan hasta el
+//   siguiente byte que imprime o avanza el papel, y solo se emiten si cambian el estado de
+//   la impresora. As desaparecen los pares activar/desactivar y las repeticiones.
+// - Se eliminan los ESC @ repetidos sin nada impreso entre medias.
+// - Las rachas de 4 o ms LF se sustituyen por ESC d n.
+// Ante un comando desconocido, el modo pgina (ESC L) o una macro (GS : / GS ^) el resto del
+// flujo se copia tal cual. Tras ESC = (seleccin de perifrico) el estado se da por desconocido.
+std::vector<uint8_t> optimizeEscPos(const uint8_t* data, size_t dataLen, EscPosOptimizeStats& stats);
+
+// Sigue el estado de la impresora comando a comando, sin modificar el flujo.
+// Lo usa la cola de impresin para saber dnde se puede dividir un documento y para
+// devolver la impresora a su estado al reanudarlo despus de otro trabajo.
+// Se asume que el documento empieza con la impresora en su estado por defecto.
+struct EscPosStateTracker {
+    int state[ESCPOS_PROP_COUNT];
+    int printMode;          // ltimo ESC ! n desde ESC @, o ESCPOS_UNKNOWN.
+    bool atLineStart;
+    bool pageMode;          // Entre ESC L y FF / ESC S.
+    bool macroDefinition;   // Entre dos GS :.
+    bool macroDefined;      // Se ha definido una macro (ESC @ no la borra).
+    bool printerEnabled;    // ESC = n con el bit 0 activo.
+    // appendRestoreCommands reproduce todo el estado: desde el ltimo ESC @ solo ha habido
+    // texto, avances de papel, cortes y comandos de modo con efecto conocido. Cualquier otro
+    // comando (rotacin, mrgenes, ajustes de cdigo de barras, caracteres definidos por el
+    // usuario...) lo pone a false hasta el siguiente ESC @.
+    bool restorable;
+
+    EscPosStateTracker();
+
+    // Procesa un comando ya delimitado con getEscPosCommandLength.
+    void process(const uint8_t* cmd, size_t len);
+
+    // Escribe ESC @ seguido de los comandos que devuelven la impresora al estado conocido.
+    void appendRestoreCommands(std::vector<uint8_t>& out) const;
+};
+
+#endif // ESCPOS_OPTIMIZER_H
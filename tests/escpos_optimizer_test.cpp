@@ -0,0 +1,398 @@
+// escpos_optimizer_test.cpp
+// Prueba de equivalencia del optimizador ESC/POS: cada flujo del corpus se imprime en un
+// simulador de impresora antes y despus de optimizeEscPos y ambos resultados deben coincidir.
+// Tambin comprueba que, en los puntos donde la cola de prioridades dividira un documento,
+// EscPosStateTracker devuelve la impresora exactamente al mismo estado tras otro trabajo.
+// Devuelve 0 si todo el corpus pasa, 1 en caso contrario.
+#include "../escpos_commands.h"
+#include "../escpos_optimizer.h"
+
+#include <stdio.h>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<long> Event;
+
+// -------------------- Simulador --------------------
+
+// Propiedades del simulador, en el mismo orden que EscPosProperty, ms la impresora habilitada (ESC =).
+const int SIM_PROPS = 12;
+const int SIM_ENABLED = 11;
+
+// Eventos que produce el simulador.
+enum SimEvent {
+    SIM_PRINT,      // carcter impreso con el estado vigente
+    SIM_FEED,       // avance de una lnea con el estado vigente
+    SIM_CLEAR,      // ESC @ con datos sin imprimir en el buffer
+    SIM_COMMAND,    // comando no seguido, copiado tal cual
+    SIM_RAW,        // byte a partir del cual el simulador deja de interpretar
+    SIM_STATE       // estado final, seguido de los ajustes no seguidos desde el ltimo ESC @
+};
+
+// Simula una impresora en modo estndar aplicando cada comando en el orden recibido.
+// 'atLineStart' indica si la impresora empieza al principio de una lnea.
+std::vector<Event> simulate(const Bytes& data, bool atLineStart) {
+    // Estado desconocido al empezar; tras ESC @ la fuente, la tabla de cdigos y el juego de
+    // caracteres toman el valor por defecto de la impresora (distinto de cualquier valor explcito).
+    long state[SIM_PROPS] = { 1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007, 1008, 1009, 1010, 1 };
+    const long initial[SIM_PROPS] = { 0, 0, 0, 2003, 0, 0, 0, 0, 256, 2009, 2010, 1 };
+    bool lineStart = atLineStart;
+    Event settings;     // Comandos que cambian ajustes que el simulador no modela (ESC V, GS L...).
+    std::vector<Event> events;
+
+    auto snapshot = [&](long kind, long value) {
+        Event e = { kind, value };
+        e.insert(e.end(), state, state + SIM_PROPS);
+        events.push_back(e);
+    };
+    auto digit = [](uint8_t n, int max) -> long {
+        int value = n >= '0' ? n - '0' : n;
+        return value <= max ? value : -1;
+    };
+    auto raw = [&](size_t from) {
+        for (size_t i = from; i < data.size(); ++i)
+            events.push_back(Event{ SIM_RAW, data[i] });
+    };
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t len = getEscPosCommandLength(data.data(), data.size(), pos);
+        if (len == 0) {
+            raw(pos);
+            break;
+        }
+        const uint8_t* cmd = data.data() + pos;
+        pos += len;
+        uint8_t k = len > 1 ? cmd[1] : 0;
+        uint8_t n = len > 2 ? cmd[2] : 0;
+
+        // Modo pgina y macros quedan fuera del simulador: el resto debe llegar idntico.
+        if ((cmd[0] == ESCPOS_ESC && k == 'L') || (cmd[0] == ESCPOS_GS && (k == ':' || k == '^'))) {
+            snapshot(SIM_COMMAND, k);
+            raw(pos);
+            break;
+        }
+        if (cmd[0] == ESCPOS_DLE) {
+            events.push_back(Event(cmd, cmd + len));
+            continue;
+        }
+        if (cmd[0] == ESCPOS_ESC && k == '=') {
+            state[SIM_ENABLED] = n & 1;
+            continue;
+        }
+        // Con la impresora deshabilitada se ignora todo lo dems.
+        if (!state[SIM_ENABLED])
+            continue;
+
+        if (len == 1) {
+            if (cmd[0] == ESCPOS_LF) {
+                snapshot(SIM_FEED, 0);
+                lineStart = true;
+            }
+            else {
+                snapshot(SIM_PRINT, cmd[0]);
+                lineStart = false;
+            }
+            continue;
+        }
+        if (cmd[0] == ESCPOS_ESC) {
+            switch (k) {
+            case '@':
+                if (!lineStart)
+                    events.push_back(Event{ SIM_CLEAR });
+                for (int i = 0; i < SIM_PROPS; ++i)
+                    state[i] = initial[i];
+                settings.clear();
+                lineStart = true;
+                continue;
+            case 'E': state[0] = n & 1; continue;
+            case 'G': state[1] = n & 1; continue;
+            case '2': state[8] = 256; continue;
+            case '3': state[8] = n; continue;
+            case 't': state[9] = n; continue;
+            case 'R': state[10] = n; continue;
+            case '{':
+                if (lineStart)
+                    state[7] = n & 1;
+                continue;
+            case '!':
+                state[0] = (n >> 3) & 1;
+                state[2] = (n >> 7) & 1;
+                state[3] = n & 1;
+                state[4] = ((n >> 4) & 1) | (((n >> 5) & 1) << 4);
+                continue;
+            case 'd':
+                for (int i = 0; i < n; ++i)
+                    snapshot(SIM_FEED, 0);
+                lineStart = true;
+                continue;
+            case '-': case 'M': case 'a': {
+                long value = digit(n, k == 'M' ? 4 : 2);
+                if (value < 0)
+                    snapshot(SIM_COMMAND, k);
+                else if (k == '-')
+                    state[2] = value;
+                else if (k == 'M')
+                    state[3] = value;
+                else if (lineStart)
+                    state[6] = value;
+                continue;
+            }
+            }
+        }
+        if (cmd[0] == ESCPOS_GS && len == 3 && k == '!') {
+            if ((n & 0x0F) <= 7 && (n >> 4) <= 7)
+                state[4] = n;
+            else
+                snapshot(SIM_COMMAND, k);
+            continue;
+        }
+        if (cmd[0] == ESCPOS_GS && len == 3 && k == 'B') {
+            state[5] = n & 1;
+            continue;
+        }
+
+        // Resto de comandos: se imprimen tal cual con el estado vigente.
+        Event e(cmd, cmd + len);
+        e.insert(e.begin(), SIM_COMMAND);
+        events.push_back(e);
+        snapshot(SIM_COMMAND, 0);
+        // Los que no imprimen, avanzan ni cortan dejan un ajuste hasta el prximo ESC @.
+        bool oneShot = (cmd[0] == ESCPOS_ESC && (k == 'p' || k == 'J' || k == '*' || k == 'i' || k == 'm')) ||
+            (cmd[0] == ESCPOS_GS && (k == 'k' || k == 'v')) || isEscPosCut(cmd, len);
+        if (!oneShot)
+            settings.insert(settings.end(), cmd, cmd + len);
+        bool keepsPosition = cmd[0] == ESCPOS_ESC && k == 'p';
+        if (!keepsPosition)
+            lineStart = (cmd[0] == ESCPOS_ESC && k == 'J') || isEscPosCut(cmd, len);
+    }
+    snapshot(SIM_STATE, 0);
+    events.back().insert(events.back().end(), settings.begin(), settings.end());
+    return events;
+}
+
+// -------------------- Corpus --------------------
+
+struct CorpusEntry {
+    const char* name;
+    Bytes data;
+};
+
+void append(Bytes& b, std::initializer_list<int> bytes) {
+    for (int x : bytes)
+        b.push_back(static_cast<uint8_t>(x));
+}
+
+void appendText(Bytes& b, const char* text) {
+    while (*text)
+        b.push_back(static_cast<uint8_t>(*text++));
+}
+
+// Ticket tpico generado por varias capas: ESC @ repetidos, negrita activada y desactivada
+// sin texto, alineacin repetida y rachas de saltos de lnea.
+Bytes layeredReceipt() {
+    Bytes b;
+    for (int copy = 0; copy < 3; ++copy) {
+        append(b, { 0x1B, '@', 0x1B, '@', 0x1B, 'a', 1, 0x1B, 'E', 1 });
+        appendText(b, "MY STORE");
+        append(b, { 0x1B, 'E', 0, 0x0A, 0x1B, 'a', 0 });
+        for (int line = 0; line < 20; ++line) {
+            append(b, { 0x1B, 'a', 0, 0x1B, 'E', 0, 0x1B, '-', 0 });
+            appendText(b, "1x COFFEE        2.50");
+            append(b, { 0x1B, 'E', 1, 0x1B, 'E', 0, 0x0A });
+        }
+        for (int line = 0; line < 6; ++line)
+            b.push_back(0x0A);
+        append(b, { 0x1D, 'V', 66, 3 });
+    }
+    return b;
+}
+
+std::vector<CorpusEntry> fixedCorpus() {
+    std::vector<CorpusEntry> corpus;
+    corpus.push_back({ "layered receipt", layeredReceipt() });
+    corpus.push_back({ "macro definition and execution",
+        { 0x1B, 'E', 1, 'A', 0x1D, ':', 0x1B, 'E', 1, 'B', 0x1D, ':', 0x1B, 'E', 0, 0x1D, '^', 1, 0, 0, 'C', 0x0A } });
+    corpus.push_back({ "peripheral device selection",
+        { 0x1B, '=', 2, 0x1B, 'E', 1, 0x1B, '=', 1, 0x1B, 'E', 1, 'X', 0x0A } });
+    corpus.push_back({ "page mode",
+        { 0x1B, '@', 0x1B, 'E', 1, 0x1B, 'L', 0x1B, 'E', 1, 'P', 0x0C, 0x1B, 'E', 1, 'Q', 0x0A } });
+    corpus.push_back({ "alignment outside line start",
+        { 0x1B, '@', 'A', 0x1B, 'a', 1, 'B', 0x0A, 0x1B, 'a', 1, 'C', 0x0A } });
+    corpus.push_back({ "raster image with LF and ESC bytes",
+        { 0x1B, '@', 0x1D, 'v', '0', 0, 2, 0, 2, 0, 0x0A, 0x1B, '@', 0x0A, 0x0A, 0x0A, 0x0A, 0x0A, 0x0A } });
+    corpus.push_back({ "truncated command", { 0x1B, 'E', 1, 'A', 0x1D, 'v', '0', 0 } });
+    corpus.push_back({ "rotation, margin and spacing before line feeds",
+        { 0x1B, '@', 0x1B, 'V', 1, 0x1D, 'L', 40, 0, 0x1B, ' ', 4, 'A', 0x0A, 'B', 0x0A,
+          0x1B, '@', 0x1B, 'E', 1, 'C', 0x0A, 'D', 0x0A } });
+    corpus.push_back({ "barcode settings and user-defined characters",
+        { 0x1B, '@', 0x1D, 'h', 80, 0x1D, 'w', 3, 0x1D, 'H', 2, 'A', 0x0A, 0x1D, 'k', 4, '1', '2', 0, 0x0A,
+          0x1B, '@', 0x1B, '&', 3, 32, 32, 1, 0xFF, 0xFF, 0xFF, 0x1B, '%', 1, ' ', 0x0A,
+          0x1B, '@', 0x1B, 'U', 1, 'B', 0x0A, 0x1B, '@', 'C', 0x0A } });
+    return corpus;
+}
+
+// Flujo aleatorio con los comandos que genera un POS tpico y algunos casos lmite.
+Bytes randomStream(std::mt19937& rng) {
+    Bytes b;
+    int tokens = rng() % 40;
+    for (int t = 0; t < tokens; ++t) {
+        switch (rng() % 34) {
+        case 0: append(b, { 0x1B, '@' }); break;
+        case 1: append(b, { 0x1B, 'E', static_cast<int>(rng() % 3) }); break;
+        case 2: append(b, { 0x1B, '-', static_cast<int>(rng() % 2 ? rng() % 4 : 48 + rng() % 4) }); break;
+        case 3: append(b, { 0x1B, 'a', static_cast<int>(rng() % 2 ? rng() % 4 : 48 + rng() % 3) }); break;
+        case 4: append(b, { 0x1D, '!', static_cast<int>(rng() % 3 == 0 ? 0x88 : (rng() % 3) * 0x11) }); break;
+        case 5: append(b, { 0x1D, 'B', static_cast<int>(rng() % 2) }); break;
+        case 6: append(b, { 0x1B, 'M', static_cast<int>(rng() % 2 ? rng() % 6 : 48 + rng() % 2) }); break;
+        case 7: append(b, { 0x1B, '2' }); break;
+        case 8: append(b, { 0x1B, '3', static_cast<int>(rng() % 3 * 30) }); break;
+        case 9: append(b, { 0x1B, 't', static_cast<int>(rng() % 3) }); break;
+        case 10: append(b, { 0x1B, 'R', static_cast<int>(rng() % 2) }); break;
+        case 11: append(b, { 0x1B, '!', static_cast<int>(rng() % 256) }); break;
+        case 12: append(b, { 0x1B, 'd', static_cast<int>(rng() % 5) }); break;
+        case 13: append(b, { 0x1B, 'J', static_cast<int>(rng() % 50) }); break;
+        case 14: append(b, { 0x1D, 'V', 66, 3 }); break;
+        case 15: append(b, { 0x1B, 'p', 0, 25, 250 }); break;
+        case 16: append(b, { 0x10, 0x04, 1 }); break;
+        case 17: append(b, { 0x1D, 'v', '0', 0, 2, 0, 2, 0, 0x0A, 0x1B, '@', 0x0A }); break;
+        case 18: append(b, { 0x1B, '{', static_cast<int>(rng() % 2) }); break;
+        case 19: append(b, { 0x1B, 'G', static_cast<int>(rng() % 2) }); break;
+        case 20: append(b, { 0x1D, 'k', 4, '1', '2', 0 }); break;
+        case 21: {
+            int count = rng() % 300;
+            for (int i = 0; i < count; ++i)
+                b.push_back(0x0A);
+            break;
+        }
+        case 22: append(b, { 0x1B, 'L' }); break;
+        case 23: append(b, { 0x1B, 0x7F }); break;
+        case 24: append(b, { 0x0D }); break;
+        case 25: append(b, { 0x1B, '=', static_cast<int>(rng() % 3) }); break;
+        case 26: append(b, { 0x1D, ':' }); break;
+        case 27: append(b, { 0x1D, '^', 1, 0, 0 }); break;
+        case 28: append(b, { 0x1B, 'V', static_cast<int>(rng() % 2) }); break;
+        case 29: append(b, { 0x1D, 'L', static_cast<int>(rng() % 64), 0 }); break;
+        case 30: append(b, { 0x1B, ' ', static_cast<int>(rng() % 8) }); break;
+        case 31: append(b, { 0x1D, 'h', static_cast<int>(40 + rng() % 100) }); break;
+        default: {
+            int count = 1 + rng() % 5;
+            for (int i = 0; i < count; ++i)
+                b.push_back(static_cast<uint8_t>('A' + rng() % 26));
+            if (rng() % 2)
+                b.push_back(0x0A);
+            break;
+        }
+        }
+    }
+    return b;
+}
+
+// -------------------- Pruebas --------------------
+
+void printBytes(const char* label, const Bytes& data) {
+    printf("  %s:", label);
+    for (uint8_t x : data)
+        printf(" %02X", x);
+    printf("\n");
+}
+
+// Optimiza 'data' y comprueba que el simulador produce lo mismo con el flujo original.
+bool checkEquivalent(const char* name, const Bytes& data, size_t& bytesIn, size_t& bytesOut) {
+    EscPosOptimizeStats stats;
+    Bytes optimized = optimizeEscPos(data.data(), data.size(), stats);
+    bool ok = stats.bytesIn == data.size() && stats.bytesOut == optimized.size();
+    for (int lineStart = 0; lineStart < 2 && ok; ++lineStart)
+        ok = simulate(data, lineStart != 0) == simulate(optimized, lineStart != 0);
+    if (!ok) {
+        printf("FAIL %s\n", name);
+        printBytes("in ", data);
+        printBytes("out", optimized);
+    }
+    bytesIn += stats.bytesIn;
+    bytesOut += stats.bytesOut;
+    return ok;
+}
+
+// Estado final del simulador (sin el tipo de evento ni el valor), empezando con la impresora
+// en su estado por defecto como supone EscPosStateTracker.
+Event finalState(const Bytes& data) {
+    Bytes initialized = { 0x1B, '@' };
+    initialized.insert(initialized.end(), data.begin(), data.end());
+    Event last = simulate(initialized, true).back();
+    return Event(last.begin() + 2, last.end());
+}
+
+// Puntos de divisin comprobados por checkRestore, para que la prueba no pase sin comprobar nada.
+size_t restorePoints = 0;
+
+// En cada salto de lnea donde la cola dividira el documento intercala un trabajo que cambia
+// varios ajustes y despus los comandos de restauracin; el estado completo del simulador
+// (incluidos los ajustes que el tracker no sigue) debe volver a ser el mismo.
+bool checkRestore(const char* name, const Bytes& data) {
+    const Bytes interruption = { 0x1B, '@', 0x1B, 'E', 1, 0x1D, '!', 0x11, 0x1B, 'a', 2, 0x1B, 't', 5, 0x1B, '3', 7,
+        0x1B, 'V', 1, 0x1D, 'L', 8, 0, 'X', 0x0A };
+    EscPosStateTracker tracker;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t len = getEscPosCommandLength(data.data(), data.size(), pos);
+        if (len == 0)
+            break;
+        tracker.process(data.data() + pos, len);
+        pos += len;
+        if (data[pos - 1] != ESCPOS_LF || len != 1 || tracker.pageMode || tracker.macroDefinition || !tracker.printerEnabled ||
+            !tracker.restorable)
+            continue;
+
+        Bytes prefix(data.begin(), data.begin() + pos);
+        Bytes resumed = prefix;
+        resumed.insert(resumed.end(), interruption.begin(), interruption.end());
+        tracker.appendRestoreCommands(resumed);
+        restorePoints++;
+        if (finalState(prefix) != finalState(resumed)) {
+            printf("FAIL restore %s at %zu\n", name, pos);
+            printBytes("in ", prefix);
+            printBytes("out", resumed);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    int failures = 0;
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+
+    for (const auto& entry : fixedCorpus()) {
+        size_t entryIn = 0;
+        size_t entryOut = 0;
+        bool ok = checkEquivalent(entry.name, entry.data, entryIn, entryOut);
+        ok = checkRestore(entry.name, entry.data) && ok;
+        if (!ok)
+            failures++;
+        printf("%-46s %6zu -> %6zu bytes\n", entry.name, entryIn, entryOut);
+        bytesIn += entryIn;
+        bytesOut += entryOut;
+    }
+
+    // Semilla fija para que el corpus aleatorio sea reproducible.
+    std::mt19937 rng(12345);
+    const int randomStreams = 20000;
+    for (int i = 0; i < randomStreams; ++i) {
+        std::string name = "random #" + std::to_string(i);
+        Bytes data = randomStream(rng);
+        bool ok = checkEquivalent(name.c_str(), data, bytesIn, bytesOut);
+        // La restauracin simula el prefijo en cada salto de lnea: basta con una muestra.
+        if (i % 10 == 0)
+            ok = checkRestore(name.c_str(), data) && ok;
+        if (!ok && ++failures > 10)
+            break;
+    }
+
+    printf("%d failures, %zu -> %zu bytes, %zu restore points\n", failures, bytesIn, bytesOut, restorePoints);
+    return failures == 0 && restorePoints > 0 ? 0 : 1;
+}
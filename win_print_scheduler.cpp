@@ -0,0 +1,448 @@
+// win_print_scheduler.cpp
+#include "pch.h"
+#include "win_print_scheduler.h"
+#include "win_printer_management.h"
+#include "escpos_commands.h"
+#include "escpos_optimizer.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <windows.h>
+#include <winspool.h>
+
+// Tamao a partir del cual se busca un punto de corte para dividir un documento ESC/POS.
+// Como cada bloque espera a que el anterior salga del spooler, a 9600 baudios un trabajo
+// urgente espera como mucho unos 4 segundos (ms lo que quede en el buffer de la impresora).
+const size_t PRINT_CHUNK_BYTES = 4096;
+
+// Tiempo mximo que se espera a que un bloque salga del spooler: un margen fijo ms lo que
+// tarda en imprimirse a 9600 baudios (aprox. 1 KB por segundo).
+const DWORD JOB_WAIT_BASE_MS = 60000;
+const DWORD JOB_WAIT_MS_PER_KB = 1000;
+
+// Cantidad de trabajos terminados que se conservan para poder consultarlos.
+const size_t MAX_FINISHED_JOBS = 256;
+
+// Diccionario de carriles de prioridad.
+std::map<std::string, PrintLane> printLanes = {
+    {"URGENT", PRINT_LANE_URGENT},
+    {"NORMAL", PRINT_LANE_NORMAL},
+    {"BULK", PRINT_LANE_BULK}
+};
+
+const wchar_t* printLaneNames[PRINT_LANE_COUNT] = { L"URGENT", L"NORMAL", L"BULK" };
+const wchar_t* queuedJobStateNames[] = { L"QUEUED", L"PRINTING", L"DONE", L"FAILED" };
+
+// -------------------- Estado de la cola --------------------
+
+// Bloque de un documento. 'restore' son los comandos que devuelven la impresora al estado
+// del documento al principio del bloque, para reanudarlo despus de otro trabajo.
+struct PrintChunk {
+    size_t end;
+    std::vector<uint8_t> restore;
+};
+
+struct ScheduledJob {
+    QueuedJobInfo info;
+    std::wstring dataType;
+    bool escPos;    // RAW con ESC/POS: se puede dividir y se le aaden ESC @ y comandos de restauracin.
+    std::vector<uint8_t> data;
+    std::vector<PrintChunk> chunks;
+    bool hasDeadline;
+    ULONGLONG deadline;
+    ULONGLONG submittedAt;
+};
+
+struct PrinterQueue {
+    std::vector<std::shared_ptr<ScheduledJob>> pending;
+    std::shared_ptr<ScheduledJob> lastJob;  // Trabajo del ltimo bloque enviado (se conserva entre hilos).
+    bool workerRunning = false;
+};
+
+std::mutex schedulerMutex;
+std::map<std::wstring, PrinterQueue> printerQueues;
+std::map<DWORD, std::shared_ptr<ScheduledJob>> scheduledJobs;
+std::deque<DWORD> finishedTickets;
+LaneMetrics laneMetrics[PRINT_LANE_COUNT] = {};
+DWORD nextTicket = 1;
+
+// -------------------- Funciones internas de la cola --------------------
+namespace WinPrinterManagement {
+
+    // Divide el documento en bloques.
+    // Solo se dividen documentos ESC/POS (otros RAW, como ZPL o EPL, van enteros), en un salto
+    // de lnea o corte de papel y nunca en medio de un
+    // comando, en modo pgina, dentro de la definicin de una macro, con la impresora
+    // deshabilitada (ESC =) ni cuando appendRestoreCommands no podra reproducir el estado
+    // (ver EscPosStateTracker::restorable). Si aparece un comando desconocido el resto va en un solo bloque.
+    std::vector<PrintChunk> splitPrintChunks(const std::vector<uint8_t>& data, bool escPos) {
+        std::vector<PrintChunk> chunks;
+        if (escPos) {
+            EscPosStateTracker tracker;
+            std::vector<uint8_t> restore;
+            size_t chunkStart = 0;
+            size_t pos = 0;
+            while (pos < data.size()) {
+                size_t commandLen = getEscPosCommandLength(data.data(), data.size(), pos);
+                if (commandLen == 0)
+                    break;
+                const uint8_t* command = data.data() + pos;
+                pos += commandLen;
+                tracker.process(command, commandLen);
+                bool safeBoundary = (commandLen == 1 && command[0] == ESCPOS_LF) || isEscPosCut(command, commandLen);
+                safeBoundary = safeBoundary && !tracker.pageMode && !tracker.macroDefinition && tracker.printerEnabled && tracker.restorable;
+                if (safeBoundary && pos - chunkStart >= PRINT_CHUNK_BYTES && pos < data.size()) {
+                    PrintChunk chunk;
+                    chunk.end = pos;
+                    chunk.restore.swap(restore);
+                    chunks.push_back(chunk);
+                    chunkStart = pos;
+                    // El bloque siguiente se reanuda con el estado que hay en este punto.
+                    tracker.appendRestoreCommands(restore);
+                }
+            }
+            PrintChunk last;
+            last.end = data.size();
+            last.restore.swap(restore);
+            chunks.push_back(last);
+            return chunks;
+        }
+        PrintChunk whole;
+        whole.end = data.size();
+        chunks.push_back(whole);
+        return chunks;
+    }
+
+    // Orden de la cola: carril, despus plazo ms cercano (sin plazo va al final) y por ltimo llegada.
+    bool runsBefore(const std::shared_ptr<ScheduledJob>& a, const std::shared_ptr<ScheduledJob>& b) {
+        if (a->info.lane != b->info.lane)
+            return a->info.lane < b->info.lane;
+        if (a->hasDeadline != b->hasDeadline)
+            return a->hasDeadline;
+        if (a->hasDeadline && a->deadline != b->deadline)
+            return a->deadline < b->deadline;
+        return a->info.ticket < b->info.ticket;
+    }
+
+    // Saca un trabajo de la cola de su impresora y libera sus datos. Requiere schedulerMutex.
+    void finishJob(PrinterQueue& queue, const std::shared_ptr<ScheduledJob>& job) {
+        queue.pending.erase(std::remove(queue.pending.begin(), queue.pending.end(), job), queue.pending.end());
+        std::vector<uint8_t>().swap(job->data);
+        std::vector<PrintChunk>().swap(job->chunks);
+
+        LaneMetrics& metrics = laneMetrics[job->info.lane];
+        metrics.pending--;
+        if (job->info.state == QUEUED_JOB_DONE) {
+            metrics.completed++;
+            if (job->hasDeadline && GetTickCount64() > job->deadline) {
+                job->info.deadlineMissed = true;
+                metrics.deadlineMisses++;
+            }
+        }
+        else {
+            metrics.failed++;
+        }
+
+        // No debe lanzar excepciones: runPrinterQueue tambin la llama al recuperarse de una.
+        // Si no hay memoria para recordar el ticket se olvida ya.
+        try {
+            finishedTickets.push_back(job->info.ticket);
+        }
+        catch (...) {
+            scheduledJobs.erase(job->info.ticket);
+        }
+        while (finishedTickets.size() > MAX_FINISHED_JOBS) {
+            scheduledJobs.erase(finishedTickets.front());
+            finishedTickets.pop_front();
+        }
+    }
+
+    // Hilo de una impresora: enva bloques mientras haya trabajos pendientes y termina al vaciarse la cola.
+    // Antes de cada bloque se vuelve a elegir el trabajo ms prioritario, y cada bloque espera a que
+    // el anterior salga del spooler; si no, todos los bloques acabaran en la cola de Windows por
+    // delante de cualquier trabajo urgente que llegue despus.
+    void runPrinterQueue(std::wstring printerName) {
+        const uint8_t ESCPOS_INIT[] = { ESCPOS_ESC, '@' };
+
+        std::unique_lock<std::mutex> lock(schedulerMutex);
+        PrinterQueue& queue = printerQueues[printerName];
+        while (!queue.pending.empty()) {
+            std::shared_ptr<ScheduledJob> job = *std::min_element(queue.pending.begin(), queue.pending.end(), runsBefore);
+            QueuedJobInfo& info = job->info;
+            // Cualquier excepcin (p. ej. bad_alloc) hace fallar el trabajo y la cola sigue con el
+            // siguiente; si saliera del hilo terminara el proceso.
+            try {
+                if (info.state == QUEUED_JOB_QUEUED) {
+                    info.state = QUEUED_JOB_PRINTING;
+                    info.waitMs = GetTickCount64() - job->submittedAt;
+                    LaneMetrics& metrics = laneMetrics[info.lane];
+                    metrics.waitSamples++;
+                    metrics.totalWaitMs += info.waitMs;
+                    metrics.maxWaitMs = (std::max)(metrics.maxWaitMs, info.waitMs);
+                }
+                size_t chunk = info.chunksPrinted;
+                size_t begin = chunk == 0 ? 0 : job->chunks[chunk - 1].end;
+                size_t end = job->chunks[chunk].end;
+                std::wstring docName = info.document;
+                if (info.chunks > 1) {
+                    std::wostringstream oss;
+                    oss << info.document << L" (" << (chunk + 1) << L"/" << info.chunks << L")";
+                    docName = oss.str();
+                }
+
+                // Al reanudar un documento tras otro trabajo se restaura su estado (ESC @ + modos).
+                // Si el trabajo anterior no termin bien (interrumpido a medias o fallido), el siguiente
+                // empieza con ESC @ para no heredar sus modos.
+                bool switching = queue.lastJob && queue.lastJob != job;
+                bool resumes = switching && chunk > 0;
+                bool interrupts = switching && queue.lastJob->info.state != QUEUED_JOB_DONE;
+                const uint8_t* prefix = nullptr;
+                size_t prefixLen = 0;
+                if (job->escPos) {
+                    if (resumes) {
+                        prefix = job->chunks[chunk].restore.data();
+                        prefixLen = job->chunks[chunk].restore.size();
+                    }
+                    else if (interrupts) {
+                        prefix = ESCPOS_INIT;
+                        prefixLen = sizeof(ESCPOS_INIT);
+                    }
+                }
+                queue.lastJob = job;
+                lock.unlock();
+
+                // Solo este hilo modifica 'data' mientras el trabajo est pendiente.
+                DWORD jobId = 0;
+                DWORD winErr = 0;
+                std::wstring errMsg;
+                std::wstring errStep;
+                std::vector<uint8_t> buffer;
+                const uint8_t* chunkData = job->data.data() + begin;
+                size_t chunkLen = end - begin;
+                if (prefixLen > 0) {
+                    buffer.reserve(prefixLen + chunkLen);
+                    buffer.insert(buffer.end(), prefix, prefix + prefixLen);
+                    buffer.insert(buffer.end(), chunkData, chunkData + chunkLen);
+                    chunkData = buffer.data();
+                    chunkLen = buffer.size();
+                }
+                bool spooled = printDirect(printerName, chunkData, chunkLen, docName, job->dataType, jobId, winErr, errMsg, errStep);
+                bool ok = false;
+                if (spooled) {
+                    // Un fallo al cambiar la prioridad no anula la impresin.
+                    DWORD ignoredErr = 0;
+                    std::wstring ignoredMsg;
+                    std::wstring ignoredStep;
+                    if (info.lane == PRINT_LANE_URGENT)
+                        setJobPriority(printerName, jobId, MAX_PRIORITY, ignoredErr, ignoredMsg, ignoredStep);
+                    // Si el bloque se borra o se queda detenido (sin papel, fuera de lnea...) el trabajo
+                    // falla y no se enva el resto; el bloque sigue en el spooler con su id en 'jobIds'.
+                    DWORD timeoutMs = JOB_WAIT_BASE_MS + static_cast<DWORD>(chunkLen / 1024) * JOB_WAIT_MS_PER_KB;
+                    ok = waitForJob(printerName, jobId, timeoutMs, winErr, errMsg, errStep);
+                }
+
+                lock.lock();
+                if (spooled)
+                    info.jobIds.push_back(jobId);
+                if (ok) {
+                    info.chunksPrinted++;
+                    if (info.chunksPrinted == info.chunks) {
+                        info.state = QUEUED_JOB_DONE;
+                        finishJob(queue, job);
+                    }
+                }
+                else {
+                    info.state = QUEUED_JOB_FAILED;
+                    info.winErr = winErr;
+                    info.errMsg = errMsg;
+                    info.errStep = errStep;
+                    finishJob(queue, job);
+                }
+            }
+            catch (...) {
+                if (!lock.owns_lock())
+                    lock.lock();
+                info.state = QUEUED_JOB_FAILED;
+                info.winErr = 0;
+                try {
+                    info.errMsg = L"Error printing queued job";
+                    info.errStep = L"TryCatch";
+                }
+                catch (...) {
+                }
+                finishJob(queue, job);
+            }
+        }
+        queue.workerRunning = false;
+    }
+
+    // Encola un trabajo y arranca el hilo de la impresora si no est en marcha.
+    // Devuelve true si se encol y asigna el ticket en outTicket.
+    bool submitPrintJob(const std::wstring& printerName, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType, bool escPos, PrintLane lane, DWORD deadlineMs,
+        DWORD& outTicket, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep) {
+
+        auto job = std::make_shared<ScheduledJob>();
+        job->data.assign(data, data + dataLen);
+        job->dataType = dataType;
+        job->escPos = escPos && _wcsicmp(dataType.c_str(), L"RAW") == 0;
+        job->chunks = splitPrintChunks(job->data, job->escPos);
+        job->submittedAt = GetTickCount64();
+        job->hasDeadline = deadlineMs > 0;
+        job->deadline = job->submittedAt + deadlineMs;
+
+        QueuedJobInfo& info = job->info;
+        info.printerName = printerName;
+        info.document = docName;
+        info.lane = lane;
+        info.state = QUEUED_JOB_QUEUED;
+        info.chunks = job->chunks.size();
+        info.chunksPrinted = 0;
+        info.waitMs = 0;
+        info.deadlineMissed = false;
+        info.winErr = 0;
+
+        std::lock_guard<std::mutex> lock(schedulerMutex);
+        PrinterQueue& queue = printerQueues[printerName];
+        if (!queue.workerRunning) {
+            try {
+                std::thread(runPrinterQueue, printerName).detach();
+            }
+            catch (const std::system_error& e) {
+                winErr = static_cast<DWORD>(e.code().value());
+                errMsg = L"Could not start print queue thread";
+                errStep = L"std::thread";
+                return false;
+            }
+            queue.workerRunning = true;
+        }
+        info.ticket = nextTicket++;
+        queue.pending.push_back(job);
+        scheduledJobs[info.ticket] = job;
+        laneMetrics[lane].submitted++;
+        laneMetrics[lane].pending++;
+
+        outTicket = info.ticket;
+        winErr = 0;
+        errMsg = L"";
+        errStep = L"";
+        return true;
+    }
+
+
+    // -------------------- Wrappers JSON --------------------
+
+    // submitPrintJobJson
+    // 'lane' vaco equivale a NORMAL; 'deadlineMs' es relativo al momento de encolar (0 = sin plazo).
+    // 'escPos' indica que los datos RAW son ESC/POS y se pueden dividir y completar con comandos.
+    std::wstring submitPrintJobJson(const std::wstring& printerName, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType, bool escPos, const std::string& lane, DWORD deadlineMs) {
+        PrintLane printLane = PRINT_LANE_NORMAL;
+        if (!lane.empty()) {
+            auto it = printLanes.find(lane);
+            if (it == printLanes.end()) {
+                return buildJsonResult(1, L"Invalid print lane", 0, L"null", L"printLanes.find");
+            }
+            printLane = it->second;
+        }
+        DWORD ticket = 0;
+        DWORD winErr = 0;
+        std::wstring errMsg;
+        std::wstring errStep;
+        try {
+            if (!submitPrintJob(printerName, data, dataLen, docName, dataType, escPos, printLane, deadlineMs, ticket, winErr, errMsg, errStep)) {
+                return buildJsonResult(1, errMsg, winErr, L"null", errStep);
+            }
+        }
+        catch (...) {
+            return buildJsonResult(1, L"Error submitting print job", 0, L"null", L"TryCatch");
+        }
+        std::wostringstream oss;
+        oss << ticket;
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
+
+    // getQueuedJobJson
+    std::wstring getQueuedJobJson(DWORD ticket) {
+        QueuedJobInfo info;
+        {
+            std::lock_guard<std::mutex> lock(schedulerMutex);
+            auto it = scheduledJobs.find(ticket);
+            if (it == scheduledJobs.end()) {
+                return buildJsonResult(1, L"Unknown ticket", 0, L"{}", L"scheduledJobs.find");
+            }
+            info = it->second->info;
+        }
+        std::wostringstream oss;
+        oss << L"{";
+        oss << L"\"ticket\":" << info.ticket << L",";
+        oss << L"\"printer\":\"" << info.printerName << L"\",";
+        oss << L"\"document\":\"" << info.document << L"\",";
+        oss << L"\"lane\":\"" << printLaneNames[info.lane] << L"\",";
+        oss << L"\"state\":\"" << queuedJobStateNames[info.state] << L"\",";
+        oss << L"\"chunks\":" << info.chunks << L",";
+        oss << L"\"chunksPrinted\":" << info.chunksPrinted << L",";
+        oss << L"\"jobIds\":[";
+        for (size_t i = 0; i < info.jobIds.size(); ++i) {
+            if (i > 0)
+                oss << L",";
+            oss << info.jobIds[i];
+        }
+        oss << L"],";
+        oss << L"\"waitMs\":" << info.waitMs << L",";
+        oss << L"\"deadlineMissed\":" << (info.deadlineMissed ? L"true" : L"false");
+        oss << L"}";
+        if (info.state == QUEUED_JOB_FAILED) {
+            return buildJsonResult(1, info.errMsg, info.winErr, oss.str(), info.errStep);
+        }
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
+
+    // getQueueMetricsJson
+    std::wstring getQueueMetricsJson() {
+        LaneMetrics metrics[PRINT_LANE_COUNT];
+        {
+            std::lock_guard<std::mutex> lock(schedulerMutex);
+            std::copy(laneMetrics, laneMetrics + PRINT_LANE_COUNT, metrics);
+        }
+        std::wostringstream oss;
+        oss << L"[";
+        for (int lane = 0; lane < PRINT_LANE_COUNT; ++lane) {
+            const LaneMetrics& m = metrics[lane];
+            if (lane > 0)
+                oss << L",";
+            oss << L"{";
+            oss << L"\"lane\":\"" << printLaneNames[lane] << L"\",";
+            oss << L"\"submitted\":" << m.submitted << L",";
+            oss << L"\"pending\":" << m.pending << L",";
+            oss << L"\"completed\":" << m.completed << L",";
+            oss << L"\"failed\":" << m.failed << L",";
+            oss << L"\"deadlineMisses\":" << m.deadlineMisses << L",";
+            oss << L"\"avgWaitMs\":" << (m.waitSamples ? m.totalWaitMs / m.waitSamples : 0) << L",";
+            oss << L"\"maxWaitMs\":" << m.maxWaitMs;
+            oss << L"}";
+        }
+        oss << L"]";
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
+
+    // getSupportedPrintLanesJson
+    std::wstring getSupportedPrintLanesJson() {
+        std::wostringstream oss;
+        oss << L"[";
+        for (int lane = 0; lane < PRINT_LANE_COUNT; ++lane) {
+            if (lane > 0)
+                oss << L",";
+            oss << L"\"" << printLaneNames[lane] << L"\"";
+        }
+        oss << L"]";
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
+} // namespace WinPrinterManagement
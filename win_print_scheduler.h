@@ -0,0 +1,72 @@
+#ifndef PRINT_SCHEDULER_H
+#define PRINT_SCHEDULER_H
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// Cola de impresin con prioridades.
+// Cada impresora tiene su propia cola; un hilo por impresora enva los trabajos pendientes
+// ordenados por carril (URGENT > NORMAL > BULK), despus por el plazo (deadline) ms cercano
+// y por ltimo por orden de llegada. Los documentos ESC/POS grandes (marcados con 'escPos') se
+// dividen en bloques en saltos de lnea o cortes de papel, y cada bloque espera a que el anterior
+// salga del spooler, as un trabajo urgente puede colarse entre dos bloques. El resto va entero y sin cambios.
+
+// Carriles de prioridad.
+enum PrintLane {
+    PRINT_LANE_URGENT = 0,
+    PRINT_LANE_NORMAL = 1,
+    PRINT_LANE_BULK = 2,
+    PRINT_LANE_COUNT = 3
+};
+
+// Estado de un trabajo encolado.
+enum QueuedJobState {
+    QUEUED_JOB_QUEUED,
+    QUEUED_JOB_PRINTING,
+    QUEUED_JOB_DONE,
+    QUEUED_JOB_FAILED
+};
+
+struct QueuedJobInfo {
+    DWORD ticket;
+    std::wstring printerName;
+    std::wstring document;
+    PrintLane lane;
+    QueuedJobState state;
+    size_t chunks;
+    size_t chunksPrinted;
+    std::vector<DWORD> jobIds;
+    ULONGLONG waitMs;
+    bool deadlineMissed;
+    DWORD winErr;
+    std::wstring errMsg;
+    std::wstring errStep;
+};
+
+// Mtricas acumuladas por carril. 'waitMs' mide el tiempo desde que se encola un trabajo
+// hasta que su primer bloque entra en el spooler. Como la cola solo entrega un bloque cuando el
+// anterior ya ha salido del spooler, equivale a la espera hasta empezar a imprimir (sin contar
+// trabajos de otras aplicaciones que ya estuvieran en la cola de Windows).
+struct LaneMetrics {
+    DWORD submitted;
+    DWORD pending;
+    DWORD completed;
+    DWORD failed;
+    DWORD deadlineMisses;
+    DWORD waitSamples;
+    ULONGLONG totalWaitMs;
+    ULONGLONG maxWaitMs;
+};
+
+namespace WinPrinterManagement {
+
+    // Funciones internas que devuelven respuestas en formato JSON (UTF-16).
+    std::wstring submitPrintJobJson(const std::wstring& printerName, const uint8_t* data, const size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType, bool escPos, const std::string& lane, DWORD deadlineMs);
+    std::wstring getQueuedJobJson(DWORD ticket);
+    std::wstring getQueueMetricsJson();
+    std::wstring getSupportedPrintLanesJson();
+}
+
+#endif // PRINT_SCHEDULER_H
@@ -1,12 +1,15 @@
 // printer_management.cpp
 #include "pch.h"
 #include "win_printer_management.h"
+#include "escpos_optimizer.h"
 
 #include <winspool.h>
 #include <map>
 #include <sstream>
 #include <memory>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <windows.h>
 
 
@@ -76,6 +79,19 @@ std::map<std::string, DWORD> jobCommands = {
     {"LAST-PAGE-EJECTED", JOB_CONTROL_LAST_PAGE_EJECTED}
 };
 
+// Estados de un trabajo que detienen waitForJob: la impresora no lo va a terminar sin que
+// alguien intervenga (borrado, sin papel, apagada, en pausa...).
+std::vector<std::pair<DWORD, std::wstring>> stoppedJobStatuses = {
+    {JOB_STATUS_DELETED, L"Print job was deleted"},
+    {JOB_STATUS_DELETING, L"Print job was deleted"},
+    {JOB_STATUS_PAPEROUT, L"Printer is out of paper"},
+    {JOB_STATUS_OFFLINE, L"Printer is offline"},
+    {JOB_STATUS_USER_INTERVENTION, L"Printer needs user intervention"},
+    {JOB_STATUS_ERROR, L"Print job is in an error state"},
+    {JOB_STATUS_BLOCKED_DEVQ, L"Print job is blocked by the driver"},
+    {JOB_STATUS_PAUSED, L"Print job is paused"}
+};
+
 // Asumiendo que PrinterInfo y JobInfo estn definidos en printer_management.h, por ejemplo:
 /// struct PrinterInfo {
 ///     std::wstring name;
@@ -247,6 +263,105 @@ namespace WinPrinterManagement {
         return true;
     }
 
+    // Cambia la prioridad de un trabajo en la cola del spooler.
+    bool setJobPriority(const std::wstring& printerName, DWORD jobId, DWORD priority, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep) {
+        PrinterHandle handle(const_cast<LPWSTR>(printerName.c_str()));
+        if (!handle) {
+            winErr = GetLastError();
+            errMsg = formatWindowsError(winErr);
+            errStep = L"OpenPrinterW";
+            return false;
+        }
+        DWORD needed = 0;
+        GetJobW(handle, jobId, 1, NULL, 0, &needed);
+        if (needed == 0) {
+            winErr = GetLastError();
+            errMsg = formatWindowsError(winErr);
+            errStep = L"GetJobW";
+            return false;
+        }
+        std::unique_ptr<BYTE[]> buffer(new BYTE[needed]);
+        if (!GetJobW(handle, jobId, 1, buffer.get(), needed, &needed)) {
+            winErr = GetLastError();
+            errMsg = formatWindowsError(winErr);
+            errStep = L"GetJobW";
+            return false;
+        }
+        JOB_INFO_1W* job = reinterpret_cast<JOB_INFO_1W*>(buffer.get());
+        job->Priority = priority;
+        job->Position = JOB_POSITION_UNSPECIFIED;
+        if (!SetJobW(handle, jobId, 1, buffer.get(), 0)) {
+            winErr = GetLastError();
+            errMsg = formatWindowsError(winErr);
+            errStep = L"SetJobW";
+            return false;
+        }
+        winErr = 0;
+        errMsg = L"";
+        errStep = L"";
+        return true;
+    }
+
+    // Espera a que el spooler termine de enviar un trabajo a la impresora.
+    // Devuelve true cuando el trabajo est completo o impreso, o cuando ya no est en la cola
+    // (GetJobW falla con ERROR_INVALID_PARAMETER). Devuelve false si se borr, si se queda
+    // detenido (ver stoppedJobStatuses) o si pasan 'timeoutMs' milisegundos.
+    // Consulta el estado cada JOB_POLL_INTERVAL_MS.
+    bool waitForJob(const std::wstring& printerName, DWORD jobId, DWORD timeoutMs, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep) {
+        const DWORD JOB_POLL_INTERVAL_MS = 100;
+        const DWORD JOB_DONE = JOB_STATUS_COMPLETE | JOB_STATUS_PRINTED;
+
+        PrinterHandle handle(const_cast<LPWSTR>(printerName.c_str()));
+        if (!handle) {
+            winErr = GetLastError();
+            errMsg = formatWindowsError(winErr);
+            errStep = L"OpenPrinterW";
+            return false;
+        }
+        ULONGLONG deadline = GetTickCount64() + timeoutMs;
+        for (;;) {
+            DWORD needed = 0;
+            GetJobW(handle, jobId, 1, NULL, 0, &needed);
+            DWORD lastErr = GetLastError();
+            if (needed > 0) {
+                std::unique_ptr<BYTE[]> buffer(new BYTE[needed]);
+                if (GetJobW(handle, jobId, 1, buffer.get(), needed, &needed)) {
+                    DWORD status = reinterpret_cast<JOB_INFO_1W*>(buffer.get())->Status;
+                    // Borrado tiene prioridad: un trabajo cancelado tambin puede salir como completo.
+                    if (!(status & (JOB_STATUS_DELETED | JOB_STATUS_DELETING)) && (status & JOB_DONE))
+                        break;
+                    for (const auto& stopped : stoppedJobStatuses) {
+                        if (status & stopped.first) {
+                            winErr = 0;
+                            errMsg = stopped.second;
+                            errStep = L"GetJobW";
+                            return false;
+                        }
+                    }
+                    if (GetTickCount64() >= deadline) {
+                        winErr = ERROR_TIMEOUT;
+                        errMsg = L"Timed out waiting for the print job to leave the spooler";
+                        errStep = L"GetJobW";
+                        return false;
+                    }
+                    Sleep(JOB_POLL_INTERVAL_MS);
+                    continue;
+                }
+                lastErr = GetLastError();
+            }
+            if (lastErr == ERROR_INVALID_PARAMETER)
+                break;
+            winErr = lastErr;
+            errMsg = formatWindowsError(winErr);
+            errStep = L"GetJobW";
+            return false;
+        }
+        winErr = 0;
+        errMsg = L"";
+        errStep = L"";
+        return true;
+    }
+
     // Obtiene los comandos de trabajo soportados.
     std::vector<std::string> getSupportedJobCommands() {
         std::vector<std::string> commands;
@@ -343,6 +458,49 @@ namespace WinPrinterManagement {
         return true;
     }
 
+    // Enva los mismos datos a varias impresoras en paralelo.
+    // Cada impresora se atiende en su propio hilo con su propio HANDLE, as una impresora lenta
+    // no retrasa a las dems. El buffer 'data' se comparte entre todos los hilos (sin copias);
+    // la funcin espera a que terminen todos antes de retornar.
+    std::vector<PrintDirectResult> printDirectMulti(const std::vector<std::wstring>& printerNames, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType) {
+
+        std::vector<PrintDirectResult> results(printerNames.size());
+        std::vector<std::thread> workers;
+        workers.reserve(printerNames.size());
+        for (size_t i = 0; i < printerNames.size(); ++i) {
+            PrintDirectResult& result = results[i];
+            result.printerName = printerNames[i];
+            result.ok = false;
+            result.jobId = 0;
+            result.winErr = 0;
+            try {
+                // Una excepcin que escape del hilo llamara a std::terminate y cerrara el proceso.
+                workers.emplace_back([&result, data, dataLen, &docName, &dataType]() {
+                    try {
+                        result.ok = printDirect(result.printerName, data, dataLen, docName, dataType,
+                            result.jobId, result.winErr, result.errMsg, result.errStep);
+                    }
+                    catch (...) {
+                        result.ok = false;
+                        result.winErr = 0;
+                        result.errMsg = L"Error printing to printer";
+                        result.errStep = L"TryCatch";
+                    }
+                });
+            }
+            catch (const std::system_error& e) {
+                result.winErr = static_cast<DWORD>(e.code().value());
+                result.errMsg = L"Could not start print thread";
+                result.errStep = L"std::thread";
+            }
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return results;
+    }
+
 
     // -------------------- Wrappers JSON --------------------
 
@@ -517,4 +675,71 @@ namespace WinPrinterManagement {
         oss << jobId;
         return buildJsonResult(0, L"", 0, oss.str(), L"");
     }
+
+    // printDirectOptimizedJson
+    // Igual que printDirectJson, pero en modo RAW pasa antes los datos por el optimizador ESC/POS.
+    std::wstring printDirectOptimizedJson(const std::wstring& printerName, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType) {
+        EscPosOptimizeStats stats = { dataLen, dataLen };
+        std::vector<uint8_t> optimized;
+        if (_wcsicmp(dataType.c_str(), L"RAW") == 0) {
+            try {
+                optimized = optimizeEscPos(data, dataLen, stats);
+            }
+            catch (...) {
+                return buildJsonResult(1, L"Error optimizing ESC/POS data", 0, L"null", L"TryCatch");
+            }
+            data = optimized.data();
+            dataLen = optimized.size();
+        }
+        DWORD jobId = 0;
+        DWORD winErr = 0;
+        std::wstring errMsg;
+        std::wstring errStep;
+        if (!printDirect(printerName, data, dataLen, docName, dataType, jobId, winErr, errMsg, errStep)) {
+            return buildJsonResult(1, errMsg, winErr, L"null", errStep);
+        }
+        std::wostringstream oss;
+        oss << L"{";
+        oss << L"\"jobId\":" << jobId << L",";
+        oss << L"\"bytesIn\":" << stats.bytesIn << L",";
+        oss << L"\"bytesOut\":" << stats.bytesOut << L",";
+        oss << L"\"bytesSaved\":" << (stats.bytesIn - stats.bytesOut);
+        oss << L"}";
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
+
+    // printDirectMultiJson
+    // La respuesta es un array con un objeto por impresora, en el mismo orden de entrada.
+    std::wstring printDirectMultiJson(const std::vector<std::wstring>& printerNames, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType) {
+        if (printerNames.empty()) {
+            return buildJsonResult(1, L"No printers given", 0, L"[]", L"printerNames");
+        }
+        auto results = printDirectMulti(printerNames, data, dataLen, docName, dataType);
+
+        std::wostringstream oss;
+        oss << L"[";
+        bool first = true;
+        bool allOk = true;
+        for (const auto& result : results) {
+            if (!first)
+                oss << L",";
+            first = false;
+            allOk = allOk && result.ok;
+            oss << L"{";
+            oss << L"\"printer\":\"" << result.printerName << L"\",";
+            oss << L"\"status\":" << (result.ok ? 0 : 1) << L",";
+            oss << L"\"err_msg\":\"" << sanitizeErrorMessage(result.errMsg) << L"\",";
+            oss << L"\"err_step\":\"" << result.errStep << L"\",";
+            oss << L"\"err_code\":" << result.winErr << L",";
+            oss << L"\"jobId\":" << (result.ok ? result.jobId : 0);
+            oss << L"}";
+        }
+        oss << L"]";
+        if (!allOk) {
+            return buildJsonResult(1, L"One or more printers failed", 0, oss.str(), L"printDirectMulti");
+        }
+        return buildJsonResult(0, L"", 0, oss.str(), L"");
+    }
 } // namespace PrinterManagement
@@ -28,8 +28,33 @@ struct JobInfo {
     DWORD pagesPrinted;
 };
 
+// Resultado de un envo RAW a una impresora concreta (usado por printDirectMulti).
+struct PrintDirectResult {
+    std::wstring printerName;
+    bool ok;
+    DWORD jobId;
+    DWORD winErr;
+    std::wstring errMsg;
+    std::wstring errStep;
+};
+
+// Construye el JSON de respuesta comn a todas las funciones exportadas.
+std::wstring buildJsonResult(int errorCode, const std::wstring& errorMessage, DWORD winErr, const std::wstring& responseJson, const std::wstring& errStep);
+
 namespace WinPrinterManagement {
 
+    // Envo RAW sncrono a una impresora (lo usan tambin la cola de prioridades y printDirectMulti).
+    bool printDirect(const std::wstring& printerName, const uint8_t* data, size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType,
+        DWORD& outJobId, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep);
+
+    // Sube o baja la prioridad de un trabajo dentro de la cola del spooler (JOB_INFO_1.Priority).
+    bool setJobPriority(const std::wstring& printerName, DWORD jobId, DWORD priority, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep);
+
+    // Espera a que un trabajo salga de la cola del spooler (enviado a la impresora o desaparecido).
+    // Falla si el trabajo se borra, se detiene (sin papel, fuera de lnea, en pausa...) o pasa 'timeoutMs'.
+    bool waitForJob(const std::wstring& printerName, DWORD jobId, DWORD timeoutMs, DWORD& winErr, std::wstring& errMsg, std::wstring& errStep);
+
     // Funciones internas que devuelven respuestas en formato JSON (UTF-16).
     std::wstring getPrintersJson();
     std::wstring getDefaultPrinterNameJson();
@@ -40,6 +65,10 @@ namespace WinPrinterManagement {
     std::wstring getSupportedPrintFormatsJson();
     std::wstring printDirectJson(const std::wstring& printerName, const uint8_t* data, const size_t dataLen,
         const std::wstring& docName, const std::wstring& dataType);
+    std::wstring printDirectOptimizedJson(const std::wstring& printerName, const uint8_t* data, const size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType);
+    std::wstring printDirectMultiJson(const std::vector<std::wstring>& printerNames, const uint8_t* data, const size_t dataLen,
+        const std::wstring& docName, const std::wstring& dataType);
 }
 
 #endif
\ No newline at end of file